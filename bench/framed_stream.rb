@@ -0,0 +1,78 @@
+#
+# Length-prefixed framing: Ruby (pack/unpack + String slicing) vs.
+# Socket::FramedStream
+#
+#   % mruby bench/framed_stream.rb
+#
+# Both ends live in one process; each round writes BATCH frames and then
+# reads them all back, so a batch must fit in the socket buffer.
+#
+
+BATCH = 64
+ROUNDS = 2000
+
+def ruby_write(sock, frames)
+  buf = ""
+  frames.each { |f| buf << [f.size].pack('N') << f }
+  sock.send(buf, 0)
+end
+
+def ruby_read(sock, buf, count)
+  frames = []
+  while frames.size < count
+    if buf.size >= 4
+      len = buf[0, 4].unpack('N')[0]
+      if buf.size >= 4 + len
+        frames << buf[4, len]
+        buf = buf[4 + len, buf.size - 4 - len]
+        next
+      end
+    end
+    buf << sock.recv(16384)
+  end
+  [ frames, buf ]
+end
+
+def bench_ruby(size)
+  a, b = UNIXSocket.pair
+  frames = [ "f" * size ] * BATCH
+  buf = ""
+  t0 = Time.now
+  ROUNDS.times {
+    ruby_write(a, frames)
+    got, buf = ruby_read(b, buf, BATCH)
+  }
+  t = Time.now - t0
+  a.close
+  b.close
+  BATCH * ROUNDS / t
+end
+
+def bench_framed(size, batch)
+  a, b = UNIXSocket.pair
+  fa = Socket::FramedStream.new(a)
+  fb = Socket::FramedStream.new(b)
+  frames = [ "f" * size ] * BATCH
+  t0 = Time.now
+  ROUNDS.times {
+    if batch
+      fa.write_frames(frames)
+      n = 0
+      n += fb.read_frames.size while n < BATCH
+    else
+      frames.each { |f| fa.write_frame(f) }
+      BATCH.times { fb.read_frame }
+    end
+  }
+  t = Time.now - t0
+  a.close
+  b.close
+  BATCH * ROUNDS / t
+end
+
+[ 16, 256, 1024 ].each { |size|
+  puts "#{size}B frames:"
+  puts "  ruby unpack           #{bench_ruby(size).round} frames/s"
+  puts "  FramedStream          #{bench_framed(size, false).round} frames/s"
+  puts "  FramedStream (batch)  #{bench_framed(size, true).round} frames/s"
+}
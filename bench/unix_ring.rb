@@ -0,0 +1,141 @@
+#
+# UNIXSocket: kernel socket path vs. shared-memory ring
+#
+#   % mruby bench/unix_ring.rb
+#       both peers in one process; the ring never sleeps, so these are
+#       "no-wakeup" numbers (memcpy vs. syscall only)
+#
+#   % mruby bench/unix_ring.rb server /tmp/ring.sock &
+#   % mruby bench/unix_ring.rb client /tmp/ring.sock
+#       peers in two processes; includes the eventfd/poll wakeup cost
+#
+
+RING_SIZE = 256 * 1024
+COUNT = 100000
+TOTAL = 64 * 1024 * 1024
+CHUNK = 65536
+
+def unix_pair(ring)
+  a, b = UNIXSocket.pair
+  if ring
+    a.shm_ring_connect(RING_SIZE)
+    b.shm_ring_accept
+    raise "shared-memory ring is not available" unless a.shm_ring?
+  end
+  [ a, b ]
+end
+
+def bench_latency(ring, count)
+  a, b = unix_pair(ring)
+  ping = "p" * 64
+  t0 = Time.now
+  count.times {
+    a.send(ping, 0)
+    b.recv(64)
+    b.send(ping, 0)
+    a.recv(64)
+  }
+  t = Time.now - t0
+  a.close
+  b.close
+  t / count * 1000000.0
+end
+
+def bench_throughput(ring, size, total)
+  a, b = unix_pair(ring)
+  mesg = "t" * size
+  n = total / size
+  t0 = Time.now
+  n.times {
+    a.send(mesg, 0)
+    b.recv(size, Socket::MSG_WAITALL)
+  }
+  t = Time.now - t0
+  a.close
+  b.close
+  n * size / t / (1024 * 1024)
+end
+
+# each connection starts with two plain bytes: transport ("s"ocket or
+# "r"ing) and test ("l"atency or "t"hroughput); "q" stops the server
+def serve(path)
+  File.unlink(path) rescue nil
+  srv = UNIXServer.new(path)
+  while true
+    s, addr = srv.accept
+    mode = s.recv(2, Socket::MSG_WAITALL)
+    if mode[0] == "q"
+      s.close
+      break
+    end
+    s.shm_ring_accept if mode[0] == "r"
+    if mode[1] == "l"
+      while true
+        m = s.recv(64, Socket::MSG_WAITALL)
+        break if m.empty?
+        s.send(m, 0)
+      end
+    else
+      while true
+        break if s.recv(CHUNK).empty?
+      end
+      s.send("k", 0)
+    end
+    s.close
+  end
+  srv.close
+  File.unlink(path)
+end
+
+def connect(path, mode)
+  s = UNIXSocket.new(path)
+  s.send(mode, 0)
+  if mode[0] == "r"
+    s.shm_ring_connect(RING_SIZE)
+    raise "shared-memory ring is not available" unless s.shm_ring?
+  end
+  s
+end
+
+def client(path)
+  [ "s", "r" ].each { |transport|
+    name = (transport == "r") ? "shm ring" : "socket  "
+
+    s = connect(path, transport + "l")
+    ping = "p" * 64
+    t0 = Time.now
+    COUNT.times {
+      s.send(ping, 0)
+      s.recv(64, Socket::MSG_WAITALL)
+    }
+    t = Time.now - t0
+    s.close
+    puts "#{name}  round trip (64B, 2 procs):   #{(t / COUNT * 1000000.0).round(2)} us"
+
+    s = connect(path, transport + "t")
+    mesg = "t" * CHUNK
+    t0 = Time.now
+    (TOTAL / CHUNK).times { s.send(mesg, 0) }
+    s.shutdown(Socket::SHUT_WR)
+    s.recv(1)
+    t = Time.now - t0
+    s.close
+    puts "#{name}  throughput (#{CHUNK}B, 2 procs): #{(TOTAL / t / (1024 * 1024)).round(1)} MB/s"
+  }
+  connect(path, "qq").close
+end
+
+case ARGV[0]
+when "server"
+  serve(ARGV[1])
+when "client"
+  client(ARGV[1])
+else
+  [ false, true ].each { |ring|
+    name = ring ? "shm ring" : "socket  "
+    puts "#{name}  round trip (64B, no-wakeup):  #{bench_latency(ring, COUNT).round(2)} us"
+    [ 64, 4096, 65536 ].each { |size|
+      puts "#{name}  throughput (#{size}B, no-wakeup): #{bench_throughput(ring, size, TOTAL).round(1)} MB/s"
+    }
+  }
+end
@@ -437,12 +437,17 @@ end
 class UNIXSocket
   def initialize(path, &block)
     self._bless
-    super(Socket._socket(AF_UNIX, SOCK_STREAM, 0), "r+")
-    Socket._connect(self.fileno, Socket.sockaddr_un(path))
-    if block
-      block.call(self)
+    if self.is_a? UNIXServer
+      # UNIXServer#initialize passes its listening descriptor here
+      super(path, "r")
     else
-      self
+      super(Socket._socket(Socket::AF_UNIX, Socket::SOCK_STREAM, 0), "r+")
+      Socket._connect(self.fileno, Socket.sockaddr_un(path))
+      if block
+        block.call(self)
+      else
+        self
+      end
     end
   end
 
@@ -459,6 +464,11 @@ class UNIXSocket
     [ "AF_UNIX", path ]
   end
 
+  def close
+    _shm_ring_close
+    super
+  end
+
   def path
     Addrinfo.new(self.getsockname).unix_path
   end
@@ -480,7 +490,7 @@ end
 class UNIXServer
   def initialize(path, &block)
     self._bless
-    super(Socket._socket(Socket::AF_UNIX, Socket::SOCK_STREAM, 0), "r")
+    super(Socket._socket(Socket::AF_UNIX, Socket::SOCK_STREAM, 0))
     Socket._bind(self.fileno, Socket.pack_sockaddr_un(path))
     listen(5)
     self
@@ -558,4 +568,10 @@ class Socket
   end
 end
 
+class Socket
+  class FramedStream
+    attr_reader :socket
+  end
+end
+
 class SocketError < StandardError; end
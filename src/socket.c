@@ -10,11 +10,23 @@
 #include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <netdb.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#ifdef SYS_memfd_create
+#define HAVE_SHM_RING
+#endif
+#endif
 
 #include "mruby/array.h"
 #include "mruby/class.h"
@@ -190,6 +202,469 @@ socket_family(int s)
   return ss.ss_family;
 }
 
+#ifdef HAVE_SHM_RING
+/*
+ * Shared-memory ring transport for same-host UNIXSocket peers.
+ *
+ * The offering side creates a memfd holding two SPSC rings (one per
+ * direction) plus two eventfds, and passes all three descriptors to the
+ * accepting side with SCM_RIGHTS.  Once negotiated, BasicSocket#send and
+ * #recv copy bytes through the mapping and only enter the kernel when a
+ * side has to sleep.  The socket itself stays open and is polled for
+ * POLLHUP so that a peer which dies without closing the ring is noticed.
+ */
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_GET_SEALS 1034
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+#define SHM_RING_SEALS   (F_SEAL_SHRINK|F_SEAL_GROW)
+
+#define SHM_RING_MAGIC   "MRBSHMR1"
+#define SHM_RING_MINCAP  4096
+#define SHM_RING_MAXCAP  (64 * 1024 * 1024)
+
+#define shm_ring_load(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define shm_ring_store(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define shm_ring_fence()      __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+/* lives in the shared mapping; producer and consumer fields on separate lines */
+struct shm_ring_ctl {
+  uint64_t tail;
+  char pad0[64 - sizeof(uint64_t)];
+  uint64_t head;
+  char pad1[64 - sizeof(uint64_t)];
+  uint32_t reader_waiting;
+  uint32_t writer_waiting;
+  uint32_t reader_closed;
+  uint32_t writer_closed;
+  char pad2[64 - 4 * sizeof(uint32_t)];
+};
+
+struct shm_ring_offer {
+  char magic[8];
+  uint32_t capacity;            /* 0: nothing to negotiate */
+  uint32_t reserved;
+};
+
+struct shm_ring {
+  int sock;
+  int side;                     /* 0: offering peer, 1: accepting peer */
+  int efd[2];                   /* efd[n] wakes up side n */
+  int pending;                  /* offer sent, answer not read yet */
+  int nonblock;
+  int peer_gone;
+  int broken;                   /* the peer wrote inconsistent indices */
+  size_t cap;
+  size_t maplen;
+  char *map;
+  struct shm_ring_ctl *tx, *rx;
+  char *txbuf, *rxbuf;
+};
+
+static void
+shm_ring_wakeup(struct shm_ring *ring)
+{
+  uint64_t one = 1;
+  ssize_t n;
+
+  do {
+    n = write(ring->efd[!ring->side], &one, sizeof(one));
+  } while (n == -1 && errno == EINTR);
+}
+
+/* half-close the ring the way shutdown(2) half-closes the socket */
+static void
+shm_ring_shutdown(struct shm_ring *ring, int how)
+{
+  if (how != SHUT_RD)
+    shm_ring_store(&ring->tx->writer_closed, 1);
+  if (how != SHUT_WR)
+    shm_ring_store(&ring->rx->reader_closed, 1);
+  shm_ring_fence();
+  if (ring->efd[!ring->side] != -1)
+    shm_ring_wakeup(ring);
+}
+
+static void
+shm_ring_release(struct shm_ring *ring)
+{
+  if (ring->map != NULL) {
+    shm_ring_shutdown(ring, SHUT_RDWR);
+    munmap(ring->map, ring->maplen);
+    ring->map = NULL;
+  }
+  if (ring->efd[0] != -1)
+    close(ring->efd[0]);
+  if (ring->efd[1] != -1)
+    close(ring->efd[1]);
+  ring->efd[0] = ring->efd[1] = -1;
+}
+
+static void
+shm_ring_free(mrb_state *mrb, void *p)
+{
+  if (p == NULL)
+    return;
+  shm_ring_release((struct shm_ring *)p);
+  mrb_free(mrb, p);
+}
+
+static const struct mrb_data_type shm_ring_type = { "ShmRing", shm_ring_free };
+
+/* "@_shm_ring", looked up on every send/recv; interned at gem init */
+static mrb_sym sym_shm_ring;
+
+static struct shm_ring *
+shm_ring_alloc(mrb_state *mrb, int s, int side)
+{
+  struct shm_ring *ring;
+  int flags;
+
+  ring = (struct shm_ring *)mrb_malloc(mrb, sizeof(struct shm_ring));
+  memset(ring, 0, sizeof(struct shm_ring));
+  ring->sock = s;
+  ring->side = side;
+  ring->efd[0] = ring->efd[1] = -1;
+  flags = fcntl(s, F_GETFL, 0);
+  ring->nonblock = (flags != -1 && (flags & O_NONBLOCK));
+  return ring;
+}
+
+/* the ring only keeps stream semantics, so datagram sockets never get one */
+static int
+shm_ring_stream_p(int s)
+{
+  int type;
+  socklen_t optlen;
+
+  optlen = sizeof(type);
+  if (getsockopt(s, SOL_SOCKET, SO_TYPE, &type, &optlen) == -1)
+    return 0;
+  return type == SOCK_STREAM;
+}
+
+static size_t
+shm_ring_maplen(size_t cap)
+{
+  return 2 * sizeof(struct shm_ring_ctl) + 2 * cap;
+}
+
+static int
+shm_ring_map(struct shm_ring *ring, int memfd)
+{
+  struct shm_ring_ctl *ctl;
+  char *data;
+  void *p;
+
+  p = mmap(NULL, ring->maplen, PROT_READ|PROT_WRITE, MAP_SHARED, memfd, 0);
+  if (p == MAP_FAILED)
+    return -1;
+  ring->map = (char *)p;
+  ctl = (struct shm_ring_ctl *)ring->map;
+  data = ring->map + 2 * sizeof(struct shm_ring_ctl);
+  ring->tx = &ctl[ring->side];
+  ring->rx = &ctl[!ring->side];
+  ring->txbuf = data + ring->side * ring->cap;
+  ring->rxbuf = data + !ring->side * ring->cap;
+  return 0;
+}
+
+static int
+shm_ring_create(struct shm_ring *ring, size_t cap)
+{
+  int memfd;
+
+  ring->cap = cap;
+  ring->maplen = shm_ring_maplen(cap);
+  memfd = syscall(SYS_memfd_create, "mruby-socket-ring", MFD_CLOEXEC|MFD_ALLOW_SEALING);
+  if (memfd == -1)
+    return -1;
+  /* sealed, so the peer cannot truncate the mapping under us (SIGBUS) */
+  if (ftruncate(memfd, ring->maplen) == -1 ||
+      fcntl(memfd, F_ADD_SEALS, SHM_RING_SEALS) == -1 ||
+      shm_ring_map(ring, memfd) == -1)
+    goto fail;
+  ring->efd[0] = eventfd(0, EFD_CLOEXEC);
+  ring->efd[1] = eventfd(0, EFD_CLOEXEC);
+  if (ring->efd[0] == -1 || ring->efd[1] == -1)
+    goto fail;
+  return memfd;
+
+fail:
+  close(memfd);
+  shm_ring_release(ring);
+  return -1;
+}
+
+/*
+ * returns -1 on error or once the peer is gone altogether; a half-close
+ * (POLLRDHUP) is not reported, shm_ring_shutdown() covers that.
+ */
+static int
+shm_ring_sleep(struct shm_ring *ring)
+{
+  struct pollfd pfd[2];
+  uint64_t cnt;
+  ssize_t n;
+
+  pfd[0].fd = ring->efd[ring->side];
+  pfd[0].events = POLLIN;
+  pfd[1].fd = ring->sock;
+  pfd[1].events = 0;
+  if (poll(pfd, 2, -1) == -1)
+    return (errno == EINTR) ? 0 : -1;
+  if (pfd[0].revents & POLLIN) {
+    do {
+      n = read(pfd[0].fd, &cnt, sizeof(cnt));
+    } while (n == -1 && errno == EINTR);
+  }
+  if (pfd[1].revents & (POLLHUP|POLLERR)) {
+    ring->peer_gone = 1;
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Both indices live in memory the peer can write to; an index pair that
+ * is further apart than the ring is large would make us copy outside of
+ * it, so such a ring is given up for good.
+ */
+static void
+shm_ring_corrupt(mrb_state *mrb, struct shm_ring *ring, const char *mesg)
+{
+  ring->broken = 1;
+  ring->peer_gone = 1;
+  errno = EPROTO;
+  mrb_sys_fail(mrb, mesg);
+}
+
+static mrb_int
+shm_ring_recv(mrb_state *mrb, struct shm_ring *ring, char *p, mrb_int maxlen, mrb_int flags)
+{
+  struct shm_ring_ctl *rx = ring->rx;
+  uint64_t head, tail;
+  size_t done, first, n, off;
+
+  if (ring->broken)
+    shm_ring_corrupt(mrb, ring, "recv");
+  head = rx->head;
+  done = 0;
+  if (rx->reader_closed)
+    return 0;
+  while (done < (size_t)maxlen) {
+    tail = shm_ring_load(&rx->tail);
+    if (tail - head > ring->cap)
+      shm_ring_corrupt(mrb, ring, "recv");
+    if (tail != head) {
+      n = (size_t)(tail - head);
+      if (n > (size_t)maxlen - done)
+        n = (size_t)maxlen - done;
+      off = (size_t)(head & (ring->cap - 1));
+      first = (n < ring->cap - off) ? n : ring->cap - off;
+      memcpy(p + done, ring->rxbuf + off, first);
+      memcpy(p + done + first, ring->rxbuf, n - first);
+      head += n;
+      done += n;
+      if (flags & MSG_PEEK)
+        break;
+      shm_ring_store(&rx->head, head);
+      shm_ring_fence();
+      if (shm_ring_load(&rx->writer_waiting))
+        shm_ring_wakeup(ring);
+      if (!(flags & MSG_WAITALL))
+        break;
+      continue;
+    }
+    if (shm_ring_load(&rx->writer_closed) || ring->peer_gone) {
+      /* the peer may have sent its last bytes just before closing */
+      if (shm_ring_load(&rx->tail) == head)
+        break;
+      continue;
+    }
+    if (ring->nonblock || (flags & MSG_DONTWAIT)) {
+      if (done > 0)
+        break;
+      errno = EAGAIN;
+      mrb_sys_fail(mrb, "recv");
+    }
+    shm_ring_store(&rx->reader_waiting, 1);
+    shm_ring_fence();
+    if (shm_ring_load(&rx->tail) == head && !shm_ring_load(&rx->writer_closed)) {
+      if (shm_ring_sleep(ring) == -1 && !ring->peer_gone) {
+        shm_ring_store(&rx->reader_waiting, 0);
+        if (done > 0)
+          break;
+        mrb_sys_fail(mrb, "poll");
+      }
+    }
+    shm_ring_store(&rx->reader_waiting, 0);
+  }
+  return (mrb_int)done;
+}
+
+static mrb_int
+shm_ring_send(mrb_state *mrb, struct shm_ring *ring, const char *p, size_t len, mrb_int flags)
+{
+  struct shm_ring_ctl *tx = ring->tx;
+  uint64_t head, tail;
+  size_t done, first, n, off;
+
+  if (ring->broken)
+    shm_ring_corrupt(mrb, ring, "send");
+  tail = tx->tail;
+  done = 0;
+  while (done < len) {
+    if (tx->writer_closed || shm_ring_load(&tx->reader_closed) || ring->peer_gone) {
+      if (done > 0)
+        break;
+      errno = EPIPE;
+      mrb_sys_fail(mrb, "send");
+    }
+    head = shm_ring_load(&tx->head);
+    if (tail - head > ring->cap)
+      shm_ring_corrupt(mrb, ring, "send");
+    n = ring->cap - (size_t)(tail - head);
+    if (n > 0) {
+      if (n > len - done)
+        n = len - done;
+      off = (size_t)(tail & (ring->cap - 1));
+      first = (n < ring->cap - off) ? n : ring->cap - off;
+      memcpy(ring->txbuf + off, p + done, first);
+      memcpy(ring->txbuf, p + done + first, n - first);
+      tail += n;
+      done += n;
+      shm_ring_store(&tx->tail, tail);
+      shm_ring_fence();
+      if (shm_ring_load(&tx->reader_waiting))
+        shm_ring_wakeup(ring);
+      continue;
+    }
+    if (ring->nonblock || (flags & MSG_DONTWAIT)) {
+      if (done > 0)
+        break;
+      errno = EAGAIN;
+      mrb_sys_fail(mrb, "send");
+    }
+    shm_ring_store(&tx->writer_waiting, 1);
+    shm_ring_fence();
+    if (shm_ring_load(&tx->head) == head && !shm_ring_load(&tx->reader_closed)) {
+      if (shm_ring_sleep(ring) == -1 && !ring->peer_gone) {
+        shm_ring_store(&tx->writer_waiting, 0);
+        if (done > 0)
+          break;
+        mrb_sys_fail(mrb, "poll");
+      }
+    }
+    shm_ring_store(&tx->writer_waiting, 0);
+  }
+  return (mrb_int)done;
+}
+
+static struct shm_ring *
+shm_ring_ptr(mrb_state *mrb, mrb_value sock)
+{
+  mrb_value v;
+
+  v = mrb_iv_get(mrb, sock, sym_shm_ring);
+  if (mrb_nil_p(v))
+    return NULL;
+  return (struct shm_ring *)mrb_get_datatype(mrb, v, &shm_ring_type);
+}
+
+static void
+shm_ring_attach(mrb_state *mrb, mrb_value sock, struct shm_ring *ring)
+{
+  struct RClass *c;
+
+  c = mrb_class_ptr(mrb_const_get(mrb, mrb_obj_value(mrb_class_get(mrb, "UNIXSocket")), mrb_intern_cstr(mrb, "ShmRing")));
+  mrb_iv_set(mrb, sock, sym_shm_ring, mrb_obj_value(mrb_data_object_alloc(mrb, c, ring, &shm_ring_type)));
+}
+
+static void
+shm_ring_detach(mrb_state *mrb, mrb_value sock)
+{
+  mrb_value v;
+
+  v = mrb_iv_get(mrb, sock, sym_shm_ring);
+  if (mrb_nil_p(v))
+    return;
+  shm_ring_free(mrb, DATA_PTR(v));
+  DATA_PTR(v) = NULL;
+  mrb_iv_set(mrb, sock, sym_shm_ring, mrb_nil_value());
+}
+
+/* like shm_ring_ptr(), but first reads the peer's answer to our offer */
+static struct shm_ring *
+shm_ring_get(mrb_state *mrb, mrb_value sock)
+{
+  struct shm_ring *ring;
+  ssize_t n;
+  char ack;
+
+  ring = shm_ring_ptr(mrb, sock);
+  if (ring == NULL || !ring->pending)
+    return ring;
+  do {
+    n = recv(ring->sock, &ack, 1, 0);
+  } while (n == -1 && errno == EINTR);
+  /* on a non-blocking socket this may be EAGAIN; the offer stays pending */
+  if (n == -1)
+    mrb_sys_fail(mrb, "recv");
+  ring->pending = 0;
+  if (n == 1 && ack == 'Y')
+    return ring;
+  /* refused (or the peer went away): fall back to the socket */
+  shm_ring_detach(mrb, sock);
+  return NULL;
+}
+#endif
+
+static mrb_int
+socket_recv(mrb_state *mrb, mrb_value sock, char *buf, mrb_int maxlen, mrb_int flags)
+{
+  int n;
+
+#ifdef HAVE_SHM_RING
+  {
+    struct shm_ring *ring = shm_ring_get(mrb, sock);
+    if (ring != NULL)
+      return shm_ring_recv(mrb, ring, buf, maxlen, flags);
+  }
+#endif
+  n = recv(socket_fd(mrb, sock), buf, maxlen, flags);
+  if (n == -1)
+    mrb_sys_fail(mrb, "recv");
+  return n;
+}
+
+static mrb_int
+socket_send(mrb_state *mrb, mrb_value sock, const char *buf, mrb_int len, mrb_int flags)
+{
+  int n;
+
+#ifdef HAVE_SHM_RING
+  {
+    struct shm_ring *ring = shm_ring_get(mrb, sock);
+    if (ring != NULL)
+      return shm_ring_send(mrb, ring, buf, len, flags);
+  }
+#endif
+  n = send(socket_fd(mrb, sock), buf, len, flags);
+  if (n == -1)
+    mrb_sys_fail(mrb, "send");
+  return n;
+}
+
 static mrb_value
 mrb_basicsocket_getpeereid(mrb_state *mrb, mrb_value self)
 { 
@@ -267,9 +742,7 @@ mrb_basicsocket_recv(mrb_state *mrb, mrb_value self)
 
   mrb_get_args(mrb, "i|i", &maxlen, &flags);
   buf = mrb_str_buf_new(mrb, maxlen);
-  n = recv(socket_fd(mrb, self), RSTRING_PTR(buf), maxlen, flags);
-  if (n == -1)
-    mrb_sys_fail(mrb, "recv");
+  n = socket_recv(mrb, self, RSTRING_PTR(buf), maxlen, flags);
   mrb_str_resize(mrb, buf, n);
   return buf;
 }
@@ -307,12 +780,12 @@ mrb_basicsocket_send(mrb_state *mrb, mrb_value self)
   dest = mrb_nil_value();
   mrb_get_args(mrb, "Si|S", &mesg, &flags, &dest);
   if (mrb_nil_p(dest)) {
-    n = send(socket_fd(mrb, self), RSTRING_PTR(mesg), RSTRING_LEN(mesg), flags);
+    n = socket_send(mrb, self, RSTRING_PTR(mesg), RSTRING_LEN(mesg), flags);
   } else {
     n = sendto(socket_fd(mrb, self), RSTRING_PTR(mesg), RSTRING_LEN(mesg), flags, (const void *)RSTRING_PTR(dest), RSTRING_LEN(dest));
+    if (n == -1)
+      mrb_sys_fail(mrb, "send");
   }
-  if (n == -1)
-    mrb_sys_fail(mrb, "send");
   return mrb_fixnum_value(n);
 }
 
@@ -334,6 +807,13 @@ mrb_basicsocket_setnonblock(mrb_state *mrb, mrb_value self)
     flags &= ~O_NONBLOCK;
   if (fcntl(fd, F_SETFL, flags) == -1)
     mrb_sys_fail(mrb, "fcntl");
+#ifdef HAVE_SHM_RING
+  {
+    struct shm_ring *ring = shm_ring_ptr(mrb, self);
+    if (ring != NULL)
+      ring->nonblock = mrb_test(bool);
+  }
+#endif
   return mrb_nil_value();
 }
 
@@ -385,9 +865,361 @@ mrb_basicsocket_shutdown(mrb_state *mrb, mrb_value self)
   mrb_get_args(mrb, "|i", &how);
   if (shutdown(socket_fd(mrb, self), how) != 0)
     mrb_sys_fail(mrb, "shutdown");
+#ifdef HAVE_SHM_RING
+  {
+    struct shm_ring *ring = shm_ring_get(mrb, self);
+    if (ring != NULL)
+      shm_ring_shutdown(ring, how);
+  }
+#endif
   return mrb_fixnum_value(0);
 }
 
+/*
+ * Socket::FramedStream - length-prefixed (u16/u32 big-endian) or
+ * delimiter-terminated messages over a stream socket.  Received bytes
+ * are kept in one buffer per stream and each payload is copied out of
+ * it once, into the String handed back to the caller.
+ */
+
+#define FRAMED_BUFSIZE    16384
+#define FRAMED_MAXFRAME   (1024 * 1024)
+
+struct framed_stream {
+  int hdrlen;                   /* 2 or 4; 0 for delimited frames */
+  char *delim;
+  size_t delimlen;
+  size_t maxframe;
+  char *buf;                    /* unread bytes are buf[head, tail) */
+  size_t capa, head, tail;
+  size_t scan;                  /* bytes past head known to hold no delimiter */
+  int eof;
+  char *wbuf;                   /* unsent bytes are wbuf[wdone, wlen) */
+  size_t wcapa, wlen, wdone;
+};
+
+static void
+framed_stream_free(mrb_state *mrb, void *p)
+{
+  struct framed_stream *fs = (struct framed_stream *)p;
+
+  if (fs == NULL)
+    return;
+  mrb_free(mrb, fs->delim);
+  mrb_free(mrb, fs->buf);
+  mrb_free(mrb, fs->wbuf);
+  mrb_free(mrb, fs);
+}
+
+static const struct mrb_data_type framed_stream_type = { "FramedStream", framed_stream_free };
+
+/* "@socket", read on every fill and flush; interned at gem init */
+static mrb_sym sym_socket;
+
+static struct framed_stream *
+framed_stream_ptr(mrb_state *mrb, mrb_value self)
+{
+  struct framed_stream *fs;
+
+  fs = (struct framed_stream *)mrb_get_datatype(mrb, self, &framed_stream_type);
+  if (fs == NULL)
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "uninitialized FramedStream");
+  return fs;
+}
+
+/*
+ * If a whole frame starts at fs->head, store the offset and length of its
+ * payload and the number of bytes it occupies, and return 1.  Returns 0
+ * if more bytes are needed and -1 if the frame exceeds fs->maxframe (with
+ * a length header, *len is then the announced length).
+ */
+static int
+framed_stream_peek(struct framed_stream *fs, size_t *off, size_t *len, size_t *used)
+{
+  const unsigned char *p = (const unsigned char *)fs->buf + fs->head;
+  const char *q;
+  size_t avail, i, n;
+
+  avail = fs->tail - fs->head;
+  if (fs->hdrlen > 0) {
+    if (avail < (size_t)fs->hdrlen)
+      return 0;
+    if (fs->hdrlen == 2)
+      n = ((size_t)p[0] << 8) | p[1];
+    else
+      n = ((size_t)p[0] << 24) | ((size_t)p[1] << 16) | ((size_t)p[2] << 8) | p[3];
+    if (n > fs->maxframe) {
+      *len = n;
+      return -1;
+    }
+    if (avail - fs->hdrlen < n)
+      return 0;
+    *off = fs->hdrlen;
+    *len = n;
+    *used = fs->hdrlen + n;
+    return 1;
+  }
+
+  for (i = fs->scan; avail - i >= fs->delimlen; i = q - (const char *)p + 1) {
+    q = memchr(p + i, fs->delim[0], avail - fs->delimlen - i + 1);
+    if (q == NULL)
+      break;
+    if (memcmp(q, fs->delim, fs->delimlen) == 0) {
+      if ((size_t)(q - (const char *)p) > fs->maxframe)
+        break;
+      fs->scan = 0;
+      *off = 0;
+      *len = q - (const char *)p;
+      *used = *len + fs->delimlen;
+      return 1;
+    }
+  }
+  fs->scan = (avail >= fs->delimlen) ? avail - fs->delimlen + 1 : 0;
+  if (fs->scan > fs->maxframe)
+    return -1;
+  return 0;
+}
+
+/* framed_stream_peek() that raises SocketError on an oversized frame */
+static int
+framed_stream_next(mrb_state *mrb, struct framed_stream *fs, size_t *off, size_t *len, size_t *used)
+{
+  int r;
+
+  r = framed_stream_peek(fs, off, len, used);
+  if (r < 0) {
+    if (fs->hdrlen > 0)
+      mrb_raisef(mrb, E_SOCKET_ERROR, "frame too large (%lu bytes, max %lu)", (unsigned long)*len, (unsigned long)fs->maxframe);
+    mrb_raisef(mrb, E_SOCKET_ERROR, "frame too large (no delimiter in %lu bytes)", (unsigned long)fs->maxframe);
+  }
+  return r;
+}
+
+/* receive more bytes; returns 0 at end of stream */
+static int
+framed_stream_fill(mrb_state *mrb, mrb_value self, struct framed_stream *fs)
+{
+  mrb_value sock;
+  mrb_int n;
+
+  if (fs->eof)
+    return 0;
+  if (fs->head > 0 && (fs->head == fs->tail || fs->capa - fs->tail < FRAMED_BUFSIZE / 4)) {
+    memmove(fs->buf, fs->buf + fs->head, fs->tail - fs->head);
+    fs->tail -= fs->head;
+    fs->head = 0;
+  }
+  if (fs->tail == fs->capa) {
+    fs->buf = (char *)mrb_realloc(mrb, fs->buf, fs->capa * 2);
+    fs->capa *= 2;
+  }
+  sock = mrb_iv_get(mrb, self, sym_socket);
+  n = socket_recv(mrb, sock, fs->buf + fs->tail, fs->capa - fs->tail, 0);
+  if (n == 0) {
+    fs->eof = 1;
+    return 0;
+  }
+  fs->tail += n;
+  return 1;
+}
+
+/* make sure a whole frame is buffered; returns 0 at a clean end of stream */
+static int
+framed_stream_wait(mrb_state *mrb, mrb_value self, struct framed_stream *fs, size_t *off, size_t *len, size_t *used)
+{
+  while (!framed_stream_next(mrb, fs, off, len, used)) {
+    if (!framed_stream_fill(mrb, self, fs)) {
+      if (fs->head != fs->tail)
+        mrb_raise(mrb, E_SOCKET_ERROR, "connection closed in the middle of a frame");
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* append +frame+ at wbuf[pos]; returns the new end, fs->wlen is left alone */
+static size_t
+framed_stream_encode(mrb_state *mrb, struct framed_stream *fs, size_t pos, mrb_value frame)
+{
+  unsigned char *p;
+  size_t len, need;
+
+  if (!mrb_string_p(frame))
+    mrb_raise(mrb, E_TYPE_ERROR, "frame must be a String");
+  len = RSTRING_LEN(frame);
+  if (len > fs->maxframe)
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "frame too large (%lu bytes, max %lu)", (unsigned long)len, (unsigned long)fs->maxframe);
+  need = pos + len + (fs->hdrlen > 0 ? (size_t)fs->hdrlen : fs->delimlen);
+  if (need > fs->wcapa) {
+    fs->wcapa = (need > fs->wcapa * 2) ? need : fs->wcapa * 2;
+    fs->wbuf = (char *)mrb_realloc(mrb, fs->wbuf, fs->wcapa);
+  }
+  p = (unsigned char *)fs->wbuf + pos;
+  if (fs->hdrlen == 2) {
+    *p++ = (len >> 8) & 0xff;
+    *p++ = len & 0xff;
+  } else if (fs->hdrlen == 4) {
+    *p++ = (len >> 24) & 0xff;
+    *p++ = (len >> 16) & 0xff;
+    *p++ = (len >> 8) & 0xff;
+    *p++ = len & 0xff;
+  }
+  memcpy(p, RSTRING_PTR(frame), len);
+  p += len;
+  if (fs->hdrlen == 0) {
+    size_t i;
+    for (i = 0; i + fs->delimlen <= len; i++) {
+      if (memcmp(RSTRING_PTR(frame) + i, fs->delim, fs->delimlen) == 0)
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "frame contains the delimiter");
+    }
+    memcpy(p, fs->delim, fs->delimlen);
+    p += fs->delimlen;
+  }
+  return p - (unsigned char *)fs->wbuf;
+}
+
+/*
+ * Send everything still buffered.  If the socket raises (e.g. EAGAIN)
+ * the unsent rest stays queued and goes out first on the next write.
+ */
+static mrb_int
+framed_stream_flush(mrb_state *mrb, mrb_value self, struct framed_stream *fs)
+{
+  mrb_value sock;
+  size_t len;
+
+  sock = mrb_iv_get(mrb, self, sym_socket);
+  len = fs->wlen - fs->wdone;
+  while (fs->wdone < fs->wlen) {
+    fs->wdone += socket_send(mrb, sock, fs->wbuf + fs->wdone, fs->wlen - fs->wdone, 0);
+  }
+  fs->wlen = fs->wdone = 0;
+  return (mrb_int)len;
+}
+
+static mrb_value
+mrb_framedstream_init(mrb_state *mrb, mrb_value self)
+{
+  struct framed_stream *fs;
+  mrb_value header, sock;
+  mrb_int maxframe = FRAMED_MAXFRAME;
+
+  header = mrb_fixnum_value(4);
+  mrb_get_args(mrb, "o|oi", &sock, &header, &maxframe);
+  if (maxframe < 0)
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "negative max frame size");
+  if (mrb_fixnum_p(header)) {
+    if (mrb_fixnum(header) != 2 && mrb_fixnum(header) != 4)
+      mrb_raise(mrb, E_ARGUMENT_ERROR, "header size must be 2 or 4");
+    /* the length header must be able to hold any accepted frame */
+    if (mrb_fixnum(header) == 2 && maxframe > 0xffff)
+      maxframe = 0xffff;
+    else if (mrb_fixnum(header) == 4 && (uint64_t)maxframe > 0xffffffffUL)
+      maxframe = 0xffffffffUL;
+  } else if (mrb_string_p(header)) {
+    if (RSTRING_LEN(header) == 0)
+      mrb_raise(mrb, E_ARGUMENT_ERROR, "empty delimiter");
+  } else {
+    mrb_raise(mrb, E_TYPE_ERROR, "header must be 2, 4, or a delimiter String");
+  }
+
+  fs = (struct framed_stream *)DATA_PTR(self);
+  if (fs != NULL)
+    framed_stream_free(mrb, fs);
+  DATA_TYPE(self) = &framed_stream_type;
+  DATA_PTR(self) = NULL;
+
+  fs = (struct framed_stream *)mrb_malloc(mrb, sizeof(struct framed_stream));
+  memset(fs, 0, sizeof(struct framed_stream));
+  DATA_PTR(self) = fs;
+  if (mrb_fixnum_p(header)) {
+    fs->hdrlen = mrb_fixnum(header);
+  } else {
+    fs->delimlen = RSTRING_LEN(header);
+    fs->delim = (char *)mrb_malloc(mrb, fs->delimlen);
+    memcpy(fs->delim, RSTRING_PTR(header), fs->delimlen);
+  }
+  fs->maxframe = maxframe;
+  fs->capa = FRAMED_BUFSIZE;
+  fs->buf = (char *)mrb_malloc(mrb, fs->capa);
+  mrb_iv_set(mrb, self, sym_socket, sock);
+  return self;
+}
+
+static mrb_value
+mrb_framedstream_read_frame(mrb_state *mrb, mrb_value self)
+{
+  struct framed_stream *fs = framed_stream_ptr(mrb, self);
+  mrb_value frame;
+  size_t len, off, used;
+
+  if (!framed_stream_wait(mrb, self, fs, &off, &len, &used))
+    return mrb_nil_value();
+  frame = mrb_str_new(mrb, fs->buf + fs->head + off, len);
+  fs->head += used;
+  return frame;
+}
+
+static mrb_value
+mrb_framedstream_read_frames(mrb_state *mrb, mrb_value self)
+{
+  struct framed_stream *fs = framed_stream_ptr(mrb, self);
+  mrb_value ary;
+  size_t len, off, used;
+  int ai;
+
+  ary = mrb_ary_new(mrb);
+  if (!framed_stream_wait(mrb, self, fs, &off, &len, &used))
+    return ary;
+  ai = mrb_gc_arena_save(mrb);
+  /* a bad frame after the first one is reported by the next call */
+  do {
+    mrb_ary_push(mrb, ary, mrb_str_new(mrb, fs->buf + fs->head + off, len));
+    fs->head += used;
+    mrb_gc_arena_restore(mrb, ai);
+  } while (framed_stream_peek(fs, &off, &len, &used) > 0);
+  return ary;
+}
+
+static mrb_value
+mrb_framedstream_write_frame(mrb_state *mrb, mrb_value self)
+{
+  struct framed_stream *fs = framed_stream_ptr(mrb, self);
+  mrb_value frame;
+
+  mrb_get_args(mrb, "S", &frame);
+  framed_stream_flush(mrb, self, fs);
+  fs->wlen = framed_stream_encode(mrb, fs, 0, frame);
+  return mrb_fixnum_value(framed_stream_flush(mrb, self, fs));
+}
+
+static mrb_value
+mrb_framedstream_flush(mrb_state *mrb, mrb_value self)
+{
+  struct framed_stream *fs = framed_stream_ptr(mrb, self);
+
+  return mrb_fixnum_value(framed_stream_flush(mrb, self, fs));
+}
+
+static mrb_value
+mrb_framedstream_write_frames(mrb_state *mrb, mrb_value self)
+{
+  struct framed_stream *fs = framed_stream_ptr(mrb, self);
+  mrb_value frames;
+  mrb_int i;
+  size_t pos;
+
+  mrb_get_args(mrb, "A", &frames);
+  framed_stream_flush(mrb, self, fs);
+  /* nothing is queued unless every frame encodes */
+  pos = 0;
+  for (i = 0; i < RARRAY_LEN(frames); i++) {
+    pos = framed_stream_encode(mrb, fs, pos, RARRAY_PTR(frames)[i]);
+  }
+  fs->wlen = pos;
+  return mrb_fixnum_value(framed_stream_flush(mrb, self, fs));
+}
+
 static mrb_value
 mrb_ipsocket_ntop(mrb_state *mrb, mrb_value klass)
 { 
@@ -600,11 +1432,206 @@ mrb_socket_socket(mrb_state *mrb, mrb_value klass)
   return mrb_fixnum_value(s);
 }
 
+static mrb_value
+mrb_unixsocket_shm_ring_accept(mrb_state *mrb, mrb_value self)
+{
+#ifdef HAVE_SHM_RING
+  struct shm_ring_offer offer;
+  struct shm_ring *ring;
+  struct cmsghdr *cmsg;
+  struct msghdr msg;
+  struct iovec iov;
+  struct stat st;
+  union {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(3 * sizeof(int))];
+  } cbuf;
+  mrb_value enable;
+  int fds[3], i, nfds, s, seals;
+  ssize_t n;
+  char ack;
+
+  enable = mrb_true_value();
+  mrb_get_args(mrb, "|o", &enable);
+  if (shm_ring_ptr(mrb, self) != NULL)
+    mrb_raise(mrb, E_SOCKET_ERROR, "shared-memory ring already negotiated");
+  s = socket_fd(mrb, self);
+  if (!shm_ring_stream_p(s))
+    return mrb_false_value();
+  ring = shm_ring_alloc(mrb, s, 1);
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = &offer;
+  iov.iov_len = sizeof(offer);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf.buf;
+  msg.msg_controllen = sizeof(cbuf.buf);
+  do {
+    n = recvmsg(s, &msg, MSG_WAITALL|MSG_CMSG_CLOEXEC);
+  } while (n == -1 && errno == EINTR);
+  if (n == -1) {
+    mrb_free(mrb, ring);
+    mrb_sys_fail(mrb, "recvmsg");
+  }
+
+  nfds = 0;
+  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      if (nfds > 3)
+        nfds = 3;
+      memcpy(fds, CMSG_DATA(cmsg), nfds * sizeof(int));
+      break;
+    }
+  }
+  if (n != sizeof(offer) || memcmp(offer.magic, SHM_RING_MAGIC, sizeof(offer.magic)) != 0) {
+    for (i = 0; i < nfds; i++)
+      close(fds[i]);
+    mrb_free(mrb, ring);
+    mrb_raise(mrb, E_SOCKET_ERROR, "invalid shared-memory ring offer");
+  }
+  if (offer.capacity == 0) {
+    /* the peer could not set up a ring and expects no answer */
+    for (i = 0; i < nfds; i++)
+      close(fds[i]);
+    mrb_free(mrb, ring);
+    return mrb_false_value();
+  }
+
+  /* a declined offer is still read and answered to keep the stream in sync */
+  ack = 'N';
+  if (mrb_test(enable) && nfds == 3 && !(msg.msg_flags & MSG_CTRUNC) &&
+      offer.capacity >= SHM_RING_MINCAP && offer.capacity <= SHM_RING_MAXCAP &&
+      (offer.capacity & (offer.capacity - 1)) == 0) {
+    ring->cap = offer.capacity;
+    ring->maplen = shm_ring_maplen(ring->cap);
+    ring->efd[0] = fds[1];
+    ring->efd[1] = fds[2];
+    nfds = 1;
+    seals = fcntl(fds[0], F_GET_SEALS);
+    if (seals != -1 && (seals & SHM_RING_SEALS) == SHM_RING_SEALS &&
+        fstat(fds[0], &st) == 0 && (size_t)st.st_size >= ring->maplen &&
+        shm_ring_map(ring, fds[0]) == 0)
+      ack = 'Y';
+  }
+  for (i = 0; i < nfds; i++)
+    close(fds[i]);
+
+  do {
+    n = send(s, &ack, 1, 0);
+  } while (n == -1 && errno == EINTR);
+  if (n == -1 || ack != 'Y') {
+    shm_ring_free(mrb, ring);
+    if (n == -1)
+      mrb_sys_fail(mrb, "send");
+    return mrb_false_value();
+  }
+  shm_ring_attach(mrb, self, ring);
+  return mrb_true_value();
+#else
+  return mrb_false_value();
+#endif
+}
+
+static mrb_value
+mrb_unixsocket_shm_ring_close(mrb_state *mrb, mrb_value self)
+{
+#ifdef HAVE_SHM_RING
+  shm_ring_detach(mrb, self);
+#endif
+  return mrb_nil_value();
+}
+
+static mrb_value
+mrb_unixsocket_shm_ring_connect(mrb_state *mrb, mrb_value self)
+{
+#ifdef HAVE_SHM_RING
+  struct shm_ring_offer offer;
+  struct shm_ring *ring;
+  struct cmsghdr *cmsg;
+  struct msghdr msg;
+  struct iovec iov;
+  union {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(3 * sizeof(int))];
+  } cbuf;
+  mrb_int capacity = 65536;
+  size_t cap;
+  int memfd, s;
+  ssize_t n;
+
+  mrb_get_args(mrb, "|i", &capacity);
+  if (capacity <= 0)
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "ring capacity must be positive");
+  if (shm_ring_ptr(mrb, self) != NULL)
+    mrb_raise(mrb, E_SOCKET_ERROR, "shared-memory ring already negotiated");
+  for (cap = SHM_RING_MINCAP; cap < (size_t)capacity && cap < SHM_RING_MAXCAP; cap <<= 1)
+    ;
+  s = socket_fd(mrb, self);
+  if (!shm_ring_stream_p(s))
+    return mrb_false_value();
+  ring = shm_ring_alloc(mrb, s, 0);
+  memfd = shm_ring_create(ring, cap);
+
+  memset(&offer, 0, sizeof(offer));
+  memcpy(offer.magic, SHM_RING_MAGIC, sizeof(offer.magic));
+  offer.capacity = (memfd == -1) ? 0 : (uint32_t)cap;
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = &offer;
+  iov.iov_len = sizeof(offer);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (memfd != -1) {
+    int fds[3] = { memfd, ring->efd[0], ring->efd[1] };
+    msg.msg_control = cbuf.buf;
+    msg.msg_controllen = sizeof(cbuf.buf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  }
+  do {
+    n = sendmsg(s, &msg, 0);
+  } while (n == -1 && errno == EINTR);
+  if (memfd != -1)
+    close(memfd);
+  if (n == -1 || memfd == -1) {
+    shm_ring_free(mrb, ring);
+    if (n == -1)
+      mrb_sys_fail(mrb, "sendmsg");
+    return mrb_false_value();
+  }
+  /* the peer's answer is read lazily, on first use of the ring */
+  ring->pending = 1;
+  shm_ring_attach(mrb, self, ring);
+  return mrb_true_value();
+#else
+  mrb_int capacity = 65536;
+
+  mrb_get_args(mrb, "|i", &capacity);
+  if (capacity <= 0)
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "ring capacity must be positive");
+  return mrb_false_value();
+#endif
+}
+
+static mrb_value
+mrb_unixsocket_shm_ring_p(mrb_state *mrb, mrb_value self)
+{
+#ifdef HAVE_SHM_RING
+  if (shm_ring_get(mrb, self) != NULL)
+    return mrb_true_value();
+#endif
+  return mrb_false_value();
+}
+
 void
 mrb_mruby_socket_gem_init(mrb_state* mrb)
 {
-  struct RClass *io, *ai, *sock, *bsock, *ipsock, *tcpsock, *udpsock, *usock;
-  struct RClass *constants;
+  struct RClass *io, *ai, *sock, *bsock, *ipsock, *tcpsock, *udpsock, *usock, *shmring;
+  struct RClass *constants, *framed;
 
   ai = mrb_define_class(mrb, "Addrinfo", mrb->object_class);
   mrb_mod_cv_set(mrb, ai, mrb_intern_cstr(mrb, "_lastai"), mrb_nil_value());
@@ -658,14 +1685,36 @@ mrb_mruby_socket_gem_init(mrb_state* mrb)
   mrb_define_class_method(mrb, sock, "socketpair", mrb_socket_socketpair, MRB_ARGS_REQ(3));
   //mrb_define_method(mrb, sock, "sysaccept", mrb_socket_accept, MRB_ARGS_NONE());
 
-  usock = mrb_define_class(mrb, "UNIXSocket", io);
+  framed = mrb_define_class_under(mrb, sock, "FramedStream", mrb->object_class);
+  MRB_SET_INSTANCE_TT(framed, MRB_TT_DATA);
+  mrb_define_method(mrb, framed, "flush", mrb_framedstream_flush, MRB_ARGS_NONE());
+  mrb_define_method(mrb, framed, "initialize", mrb_framedstream_init, MRB_ARGS_REQ(1)|MRB_ARGS_OPT(2));
+  mrb_define_method(mrb, framed, "read_frame", mrb_framedstream_read_frame, MRB_ARGS_NONE());
+  mrb_define_method(mrb, framed, "read_frames", mrb_framedstream_read_frames, MRB_ARGS_NONE());
+  mrb_define_method(mrb, framed, "write_frame", mrb_framedstream_write_frame, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, framed, "write_frames", mrb_framedstream_write_frames, MRB_ARGS_REQ(1));
+
+  usock = mrb_define_class(mrb, "UNIXSocket", bsock);
   //mrb_define_class_method(mrb, usock, "pair", mrb_unixsocket_open, MRB_ARGS_OPT(2));
   //mrb_define_class_method(mrb, usock, "socketpair", mrb_unixsocket_open, MRB_ARGS_OPT(2));
+  mrb_define_method(mrb, usock, "_shm_ring_close", mrb_unixsocket_shm_ring_close, MRB_ARGS_NONE());
+  mrb_define_method(mrb, usock, "shm_ring?", mrb_unixsocket_shm_ring_p, MRB_ARGS_NONE());
+  mrb_define_method(mrb, usock, "shm_ring_accept", mrb_unixsocket_shm_ring_accept, MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, usock, "shm_ring_connect", mrb_unixsocket_shm_ring_connect, MRB_ARGS_OPT(1));
+  shmring = mrb_define_class_under(mrb, usock, "ShmRing", mrb->object_class);
+  MRB_SET_INSTANCE_TT(shmring, MRB_TT_DATA);
 
   //mrb_define_method(mrb, usock, "recv_io", mrb_unixsocket_peeraddr, MRB_ARGS_NONE());
   //mrb_define_method(mrb, usock, "recvfrom", mrb_unixsocket_peeraddr, MRB_ARGS_NONE());
   //mrb_define_method(mrb, usock, "send_io", mrb_unixsocket_peeraddr, MRB_ARGS_NONE());
 
+  mrb_define_class(mrb, "UNIXServer", usock);
+
+#ifdef HAVE_SHM_RING
+  sym_shm_ring = mrb_intern_cstr(mrb, "@_shm_ring");
+#endif
+  sym_socket = mrb_intern_cstr(mrb, "@socket");
+
   constants = mrb_define_module_under(mrb, sock, "Constants");
 
 #define define_const(SYM) \
@@ -129,6 +129,186 @@ end
 #assert('TCPSocket#close') do
 #assert('TCPSocket#write') do
 
+assert('UNIXServer.new') do
+  path = "/tmp/mruby-socket-test.sock"
+  File.unlink(path) rescue nil
+  s = UNIXServer.new(path)
+  assert_true(s.is_a? UNIXServer)
+  c = UNIXSocket.new(path)
+  a, addr = s.accept
+  assert_true(a.is_a? UNIXSocket)
+  c.send("ping", 0)
+  assert_equal("ping", a.recv(10))
+  a.close
+  c.close
+  s.close
+  File.unlink(path)
+  true
+end
+
+assert('UNIXSocket#shm_ring_connect') do
+  a, b = UNIXSocket.pair
+  offered = a.shm_ring_connect(4096)
+  assert_equal(offered, b.shm_ring_accept)
+  assert_equal(offered, a.shm_ring?)
+  assert_equal(offered, b.shm_ring?)
+  assert_equal(5, a.send("hello", 0))
+  assert_equal("hel", b.recv(3))
+  assert_equal("lo", b.recv(10))
+  b.send("world", 0)
+  assert_equal("wo", a.recv(2, Socket::MSG_PEEK))
+  assert_equal("world", a.recv(10))
+  a.close
+  assert_equal("", b.recv(10))
+  b.close
+  true
+end
+
+assert('UNIXSocket#shm_ring_connect on a datagram socket') do
+  a, b = UNIXSocket.socketpair(Socket::SOCK_DGRAM)
+  assert_false(a.shm_ring_connect(4096))
+  assert_false(b.shm_ring_accept)
+  assert_raise(ArgumentError) { a.shm_ring_connect(0) }
+  assert_raise(ArgumentError) { a.shm_ring_connect(-1) }
+  a.send("dgram", 0)
+  assert_equal("dgram", b.recv(10))
+  a.close
+  b.close
+  true
+end
+
+assert('UNIXSocket shared-memory ring wrap-around') do
+  a, b = UNIXSocket.pair
+  if a.shm_ring_connect(4096) and b.shm_ring_accept and a.shm_ring?
+    data = ("0123456789abcdefghijklmnopq" * 112)[0, 3000]
+    2.times {
+      assert_equal(3000, a.send(data, 0))
+      assert_equal(data, b.recv(4096))
+    }
+    # fill the ring completely
+    assert_equal(4096, a.send("z" * 5000, Socket::MSG_DONTWAIT))
+    assert_raise(SystemCallError) { a.send("z", Socket::MSG_DONTWAIT) }
+    assert_equal("z" * 4096, b.recv(8192))
+    assert_equal(1, a.send("z", Socket::MSG_DONTWAIT))
+  end
+  a.close
+  b.close
+  true
+end
+
+assert('UNIXSocket shared-memory ring half-close') do
+  a, b = UNIXSocket.pair
+  a.shm_ring_connect(4096)
+  b.shm_ring_accept
+  a.send("request", 0)
+  a.shutdown(Socket::SHUT_WR)
+  assert_equal("request", b.recv(100))
+  assert_equal("", b.recv(100))
+  assert_equal(8, b.send("response", 0))
+  assert_equal("response", a.recv(100))
+  a.close
+  b.close
+  true
+end
+
+assert('UNIXSocket shared-memory ring inherits O_NONBLOCK') do
+  a, b = UNIXSocket.pair
+  a._setnonblock(true)
+  a.shm_ring_connect(4096)
+  b.shm_ring_accept
+  assert_raise(SystemCallError) { a.recv(10) }
+  b.send("x", 0)
+  assert_equal("x", a.recv(10))
+  a.close
+  b.close
+  true
+end
+
+assert('UNIXSocket#shm_ring_accept(false)') do
+  a, b = UNIXSocket.pair
+  a.shm_ring_connect(4096)
+  assert_false(b.shm_ring_accept(false))
+  assert_false(a.shm_ring?)
+  assert_false(b.shm_ring?)
+  a.send("plain", 0)
+  assert_equal("plain", b.recv(10))
+  b.send("back", 0)
+  assert_equal("back", a.recv(10))
+  a.close
+  b.close
+  true
+end
+
+assert('Socket::FramedStream') do
+  a, b = UNIXSocket.pair
+  fa = Socket::FramedStream.new(a)
+  fb = Socket::FramedStream.new(b)
+  assert_equal(9, fa.write_frame("hello"))
+  assert_equal("hello", fb.read_frame)
+  fa.write_frames([ "x", "", "yz" ])
+  assert_equal([ "x", "", "yz" ], fb.read_frames)
+  a.send([3].pack('N') + "ab", 0)
+  a.send("c", 0)
+  assert_equal("abc", fb.read_frame)
+
+  s = Socket::FramedStream.new(a, 2, 4)
+  assert_raise(ArgumentError) { s.write_frame("12345") }
+  a.send([5].pack('n') + "12345", 0)
+  assert_raise(SocketError) { Socket::FramedStream.new(b, 2, 4).read_frame }
+  s = Socket::FramedStream.new(b, 2, 4)
+  a.send([1].pack('n') + "1" + [2].pack('n') + "12" + [5].pack('n'), 0)
+  assert_equal([ "1", "12" ], s.read_frames)
+  assert_raise(SocketError) { s.read_frames }
+  a.close
+  b.close
+
+  a, b = UNIXSocket.pair
+  fa = Socket::FramedStream.new(a, "\r\n")
+  fb = Socket::FramedStream.new(b, "\r\n")
+  fa.write_frames([ "one", "two" ])
+  assert_equal("one", fb.read_frame)
+  assert_equal("two", fb.read_frame)
+  assert_raise(ArgumentError) { fa.write_frame("a\r\nb") }
+  a.close
+  assert_nil(fb.read_frame)
+  b.close
+  true
+end
+
+assert('Socket::FramedStream#flush') do
+  a, b = UNIXSocket.pair
+  fa = Socket::FramedStream.new(a)
+  fb = Socket::FramedStream.new(b)
+  filler = 0
+  begin
+    while true
+      filler += a.send("f" * 4096, Socket::MSG_DONTWAIT)
+    end
+  rescue SystemCallError
+  end
+  a._setnonblock(true)
+  frame = "x" * 300000
+  assert_raise(SystemCallError) { fa.write_frame(frame) }
+  b.recv(filler, Socket::MSG_WAITALL)
+  data = ""
+  while true
+    begin
+      fa.flush
+      break
+    rescue SystemCallError
+      data << b.recv(65536)
+    end
+  end
+  data << b.recv(65536) while data.size < frame.size + 4
+  assert_equal([frame.size].pack('N') + frame, data)
+  a._setnonblock(false)
+  fa.write_frame("next")
+  assert_equal("next", fb.read_frame)
+  a.close
+  b.close
+  true
+end
+
 assert('Socket.gethostname') do
   assert_true(Socket.gethostname.is_a? String)
 end